@@ -0,0 +1,475 @@
+// On-disk archive of probe results: segment writer and reader library.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "archive.h"
+
+#define VARINT_MAX_LEN 10
+
+static int write_at(int fd, const void *buffer, size_t len, int64_t offset);
+static int archive_flush(struct archive *archive);
+static int archive_create(struct archive *archive);
+static int archive_finish(struct archive *archive);
+
+/**
+ * @brief zigzag() maps signed to unsigned so that small magnitudes give small varints.
+ */
+static inline uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+/**
+ * @brief unzigzag() reverses zigzag().
+ */
+static inline int64_t unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * @brief put_varint() writes a LEB128 varint.
+ *
+ * @param p - the output buffer, at least VARINT_MAX_LEN bytes.
+ * @param v - the value.
+ * @return size_t - the number of bytes written.
+ */
+static inline size_t put_varint(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80)
+	{
+		p[n++] = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+
+	return n;
+}
+
+/**
+ * @brief get_varint() reads a LEB128 varint.
+ *
+ * @param p - the position in the input, advanced past the varint.
+ * @param end - the end of the input.
+ * @param v - the value.
+ * @return int 0 if sucsesfull, -1 if the input is truncated or corrupt.
+ */
+static inline int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+	uint64_t result = 0;
+
+	for (int shift = 0; *p < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = *(*p)++;
+		result |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			*v = result;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief archive_open() prepares the archive of a target, the directory is created if needed.
+ * The segment file itself is created when its first block is written.
+ *
+ * @param dir - the archive directory.
+ * @param target - the IPv4 address of the target, network order.
+ * @return struct archive* - the archive, NULL if failed (errno is set).
+ */
+struct archive *archive_open(const char *dir, uint32_t target)
+{
+	if (strlen(dir) >= sizeof(((struct archive *)NULL)->dir))
+	{
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+		return NULL;
+
+	struct archive *archive = calloc(1, sizeof(struct archive));
+	if (archive == NULL)
+		return NULL;
+	strcpy(archive->dir, dir);
+	archive->target = target;
+	archive->fd = -1;
+
+	return archive;
+}
+
+/**
+ * @brief archive_append() adds a probe result, a block is written every ARCHIVE_BLOCK_RECORDS results,
+ * or as soon as the buffered results span ARCHIVE_BLOCK_SPAN_IN_US.
+ *
+ * @param archive - the archive.
+ * @param ts - the time the probe was sent, us since the epoch.
+ * @param rtt - the round trip time in us, ARCHIVE_LOST if the probe was lost.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set).
+ */
+int archive_append(struct archive *archive, int64_t ts, int32_t rtt)
+{
+	archive->ts[archive->count] = ts;
+	archive->rtt[archive->count] = rtt;
+	archive->count++;
+
+	if (archive->count < ARCHIVE_BLOCK_RECORDS && ts - archive->ts[0] < ARCHIVE_BLOCK_SPAN_IN_US)
+		return 0;
+
+	return archive_flush(archive);
+}
+
+/**
+ * @brief archive_close() writes the pending results and the index footer, then frees the archive.
+ *
+ * @param archive - the archive, may be NULL.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set).
+ */
+int archive_close(struct archive *archive)
+{
+	int result = 0;
+
+	if (archive == NULL)
+		return 0;
+	if (archive->count > 0 && archive_flush(archive) == -1)
+		result = -1;
+	if (archive->fd != -1 && archive_finish(archive) == -1)
+		result = -1;
+	free(archive);
+
+	return result;
+}
+
+/**
+ * @brief archive_flush() encodes the buffered results as a block and appends it to the segment.
+ *
+ * @param archive - the archive.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set), the results are dropped either way.
+ */
+static int archive_flush(struct archive *archive)
+{
+	uint8_t ts_col[ARCHIVE_BLOCK_RECORDS * VARINT_MAX_LEN], rtt_col[ARCHIVE_BLOCK_RECORDS * VARINT_MAX_LEN];
+	uint8_t data[sizeof(struct archive_block_header) + sizeof(ts_col) + sizeof(rtt_col)];
+	struct archive_block_header block;
+	uint32_t n = archive->count;
+	size_t ts_len = 0, rtt_len = 0;
+	int64_t previous_delta = 0, previous_rtt = 0;
+	uint16_t lost = 0;
+
+	archive->count = 0;
+
+	if (archive->fd == -1 && archive_create(archive) == -1)
+		return -1;
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		if (i > 0)
+		{
+			int64_t delta = archive->ts[i] - archive->ts[i - 1];
+			ts_len += put_varint(ts_col + ts_len, zigzag(delta - previous_delta));
+			previous_delta = delta;
+		}
+
+		int64_t value = archive->rtt[i] == ARCHIVE_LOST ? 0 : (int64_t)archive->rtt[i] + 1;
+		rtt_len += put_varint(rtt_col + rtt_len, zigzag(value - previous_rtt));
+		previous_rtt = value;
+		if (value == 0)
+			lost++;
+	}
+
+	block.magic = ARCHIVE_BLOCK_MAGIC;
+	block.count = n;
+	block.lost = lost;
+	block.first = archive->ts[0];
+	block.last = archive->ts[n - 1];
+	block.ts_len = ts_len;
+	block.rtt_len = rtt_len;
+
+	memcpy(data, &block, sizeof(block));
+	memcpy(data + sizeof(block), ts_col, ts_len);
+	memcpy(data + sizeof(block) + ts_len, rtt_col, rtt_len);
+	if (write_at(archive->fd, data, sizeof(block) + ts_len + rtt_len, archive->offset) == -1)
+	{
+		// Cut a partly written block, so the index and the next blocks stay where the offsets say.
+		// If even that fails, the segment is closed as it is: a walk of its blocks stops before the torn one.
+		int error = errno;
+		if (ftruncate(archive->fd, archive->offset) == -1)
+		{
+			close(archive->fd);
+			archive->fd = -1;
+		}
+		errno = error;
+		return -1;
+	}
+
+	archive->index[archive->nblocks++] = (struct archive_index_entry){
+		.offset = archive->offset, .first = block.first, .last = block.last, .count = n, .lost = lost};
+	archive->offset += sizeof(block) + ts_len + rtt_len;
+
+	if (archive->nblocks == ARCHIVE_SEGMENT_BLOCKS)
+		return archive_finish(archive);
+
+	return 0;
+}
+
+/**
+ * @brief archive_create() creates a new segment, named after its first result, and writes its header.
+ * An existing segment is never overwritten (a restart, or a clock set back): the name is moved forward instead.
+ *
+ * @param archive - the archive, with the results of the first block buffered.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set), no segment is open then.
+ */
+static int archive_create(struct archive *archive)
+{
+	char path[sizeof(archive->dir) + 64], space[INET_ADDRSTRLEN];
+	struct archive_file_header header = {.magic = ARCHIVE_MAGIC, .version = ARCHIVE_VERSION, .target = archive->target};
+	int64_t name = archive->ts[0];
+
+	inet_ntop(AF_INET, &archive->target, space, INET_ADDRSTRLEN);
+	do
+	{
+		snprintf(path, sizeof(path), "%s/%s-%ld.seg", archive->dir, space, name++);
+		archive->fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	} while (archive->fd == -1 && errno == EEXIST);
+	if (archive->fd == -1)
+		return -1;
+
+	if (write_at(archive->fd, &header, sizeof(header), 0) == -1)
+	{
+		int error = errno;
+		close(archive->fd);
+		unlink(path);
+		archive->fd = -1;
+		errno = error;
+		return -1;
+	}
+	archive->offset = sizeof(header);
+	archive->nblocks = 0;
+
+	return 0;
+}
+
+/**
+ * @brief archive_finish() appends the index footer and closes the segment, the next block starts a new one.
+ *
+ * @param archive - the archive.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set).
+ */
+static int archive_finish(struct archive *archive)
+{
+	struct archive_trailer trailer = {
+		.nblocks = archive->nblocks, .magic = ARCHIVE_INDEX_MAGIC, .index_offset = archive->offset};
+	int result = 0;
+
+	size_t index_len = archive->nblocks * sizeof(struct archive_index_entry);
+
+	// Without its whole footer, the segment is still readable by walking its blocks.
+	if (write_at(archive->fd, archive->index, index_len, archive->offset) == -1 ||
+		write_at(archive->fd, &trailer, sizeof(trailer), archive->offset + index_len) == -1)
+	{
+		int error = errno;
+		if (ftruncate(archive->fd, archive->offset) == -1)
+			error = errno; // a torn footer does not match its magic either, the blocks are still walked
+		errno = error;
+		result = -1;
+	}
+	close(archive->fd);
+	archive->fd = -1;
+
+	return result;
+}
+
+/**
+ * @brief write_at() writes the whole buffer at the given offset of the file.
+ *
+ * @return int 0 if sucsesfull, -1 if failed (errno is set).
+ */
+static int write_at(int fd, const void *buffer, size_t len, int64_t offset)
+{
+	const char *p = buffer;
+
+	while (len > 0)
+	{
+		ssize_t w = pwrite(fd, p, len, offset);
+		if (w == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += w;
+		len -= w;
+		offset += w;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief archive_segment_open() maps a segment for reading, the blocks are only paged in when decoded.
+ *
+ * @param segment - the segment to set up.
+ * @param path - the segment file.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set).
+ */
+int archive_segment_open(struct archive_segment *segment, const char *path)
+{
+	struct archive_file_header header;
+	struct archive_trailer trailer;
+	struct stat st;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(header))
+	{
+		close(fd);
+		errno = EPROTO;
+		return -1;
+	}
+
+	const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return -1;
+
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION)
+	{
+		munmap((void *)data, st.st_size);
+		errno = EPROTO;
+		return -1;
+	}
+
+	segment->data = data;
+	segment->size = st.st_size;
+	segment->target = header.target;
+	segment->nblocks = 0;
+	segment->index_offset = 0;
+
+	// A complete segment ends with its index, check that it is consistent before trusting it.
+	if (segment->size >= sizeof(header) + sizeof(trailer))
+	{
+		memcpy(&trailer, data + segment->size - sizeof(trailer), sizeof(trailer));
+		if (trailer.magic == ARCHIVE_INDEX_MAGIC && trailer.index_offset >= (int64_t)sizeof(header) &&
+			(uint64_t)trailer.index_offset + (uint64_t)trailer.nblocks * sizeof(struct archive_index_entry) +
+					sizeof(trailer) ==
+				segment->size)
+		{
+			segment->nblocks = trailer.nblocks;
+			segment->index_offset = trailer.index_offset;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief archive_segment_close() unmaps the segment.
+ *
+ * @param segment - the segment.
+ */
+void archive_segment_close(struct archive_segment *segment)
+{
+	munmap((void *)segment->data, segment->size);
+	segment->data = NULL;
+}
+
+/**
+ * @brief archive_segment_entry() reads an entry of the index footer.
+ *
+ * @param segment - the segment.
+ * @param n - the block number, below segment->nblocks.
+ * @param entry - the entry.
+ * @return int 0 if sucsesfull, -1 if there is no such entry.
+ */
+int archive_segment_entry(const struct archive_segment *segment, uint32_t n, struct archive_index_entry *entry)
+{
+	if (n >= segment->nblocks)
+		return -1;
+	memcpy(entry, segment->data + segment->index_offset + (size_t)n * sizeof(struct archive_index_entry),
+		   sizeof(struct archive_index_entry));
+
+	return 0;
+}
+
+/**
+ * @brief archive_segment_next() reads the block header at the given offset, to walk a segment without index.
+ * The first block is at sizeof(struct archive_file_header).
+ *
+ * @param segment - the segment.
+ * @param offset - the offset of the block header.
+ * @param block - the block header.
+ * @return int64_t - the offset of the following block, -1 if there is no valid block at this offset.
+ */
+int64_t archive_segment_next(const struct archive_segment *segment, int64_t offset, struct archive_block_header *block)
+{
+	int64_t end = segment->nblocks > 0 ? segment->index_offset : (int64_t)segment->size;
+
+	if (offset < 0 || offset + (int64_t)sizeof(*block) > end)
+		return -1;
+	memcpy(block, segment->data + offset, sizeof(*block));
+
+	int64_t next = offset + sizeof(*block) + (int64_t)block->ts_len + block->rtt_len;
+	if (block->magic != ARCHIVE_BLOCK_MAGIC || block->count == 0 || block->count > ARCHIVE_BLOCK_RECORDS ||
+		next > end)
+		return -1;
+
+	return next;
+}
+
+/**
+ * @brief archive_block_decode() decodes the columns of a block.
+ *
+ * @param segment - the segment.
+ * @param offset - the offset of the block header.
+ * @param block - the block header, as read by archive_segment_next().
+ * @param ts - the timestamps output, block->count entries.
+ * @param rtt - the RTTs output, block->count entries, ARCHIVE_LOST for lost probes.
+ * @return int 0 if sucsesfull, -1 if the block is corrupt.
+ */
+int archive_block_decode(const struct archive_segment *segment, int64_t offset,
+						 const struct archive_block_header *block, int64_t *ts, int32_t *rtt)
+{
+	const uint8_t *p = segment->data + offset + sizeof(*block);
+	const uint8_t *ts_end = p + block->ts_len, *rtt_end = ts_end + block->rtt_len;
+	int64_t delta = 0, value = 0;
+	uint64_t v;
+
+	ts[0] = block->first;
+	for (uint32_t i = 1; i < block->count; i++)
+	{
+		if (get_varint(&p, ts_end, &v) == -1)
+			return -1;
+		delta += unzigzag(v);
+		ts[i] = ts[i - 1] + delta;
+	}
+
+	p = ts_end;
+	for (uint32_t i = 0; i < block->count; i++)
+	{
+		if (get_varint(&p, rtt_end, &v) == -1)
+			return -1;
+		value += unzigzag(v);
+		rtt[i] = value == 0 ? ARCHIVE_LOST : (int32_t)(value - 1);
+	}
+
+	return 0;
+}
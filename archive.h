@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * On-disk archive of probe results: a directory of append-only segments, each holding a single target.
+ *
+ * A segment (<dir>/<ip>-<first timestamp in us>.seg) is a file header, then blocks of up to
+ * ARCHIVE_BLOCK_RECORDS results, then an index footer once the segment is complete.
+ * Every block stores its results as two columns of zigzag varints:
+ *  - timestamps: delta-of-delta from the block's first timestamp (near 0 for a steady interval),
+ *  - RTTs: delta from the previous value, where a value is rtt_us + 1, or 0 for a lost probe.
+ * A segment without its footer (the prober was killed) is still readable by walking its blocks, so
+ * a crash loses at most the results of the last ARCHIVE_BLOCK_SPAN_IN_US.
+ */
+
+#define ARCHIVE_MAGIC 0x47455350	   // "PSEG"
+#define ARCHIVE_BLOCK_MAGIC 0x4b4c4250 // "PBLK"
+#define ARCHIVE_INDEX_MAGIC 0x58444950 // "PIDX"
+#define ARCHIVE_VERSION 1
+
+#define ARCHIVE_BLOCK_RECORDS 256	// results per block, written with a single write()
+#define ARCHIVE_BLOCK_SPAN_IN_US (60 * 1000 * 1000) // a block is also written once it spans this long
+#define ARCHIVE_SEGMENT_BLOCKS 1024 // blocks per segment (about 17 hours at one probe per second)
+#define ARCHIVE_LOST -1				// RTT of a lost probe
+
+struct archive_file_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t target; // IPv4 address of the target, network order
+	uint32_t reserved2;
+};
+
+struct archive_block_header
+{
+	uint32_t magic;
+	uint16_t count; // results in the block
+	uint16_t lost;	// lost probes among them
+	int64_t first;	// first timestamp, us since the epoch
+	int64_t last;	// last timestamp
+	uint32_t ts_len;  // bytes of the timestamps column
+	uint32_t rtt_len; // bytes of the RTTs column
+};
+
+struct archive_index_entry
+{
+	int64_t offset; // of the block header in the segment
+	int64_t first;
+	int64_t last;
+	uint32_t count;
+	uint32_t lost;
+};
+
+struct archive_trailer
+{
+	uint32_t nblocks;
+	uint32_t magic;
+	int64_t index_offset;
+};
+
+// Writer side.
+struct archive
+{
+	char dir[256];
+	uint32_t target;
+	int fd; // current segment, -1 if none
+	int64_t offset;
+	struct archive_index_entry index[ARCHIVE_SEGMENT_BLOCKS];
+	uint32_t nblocks;
+	uint32_t count;
+	int64_t ts[ARCHIVE_BLOCK_RECORDS];
+	int32_t rtt[ARCHIVE_BLOCK_RECORDS];
+};
+
+// Reader side, a mapped segment.
+struct archive_segment
+{
+	const uint8_t *data;
+	size_t size;
+	uint32_t target;
+	uint32_t nblocks; // blocks listed by the footer, 0 if the segment has none
+	int64_t index_offset;
+};
+
+struct archive *archive_open(const char *dir, uint32_t target);
+int archive_append(struct archive *archive, int64_t ts, int32_t rtt);
+int archive_close(struct archive *archive);
+
+int archive_segment_open(struct archive_segment *segment, const char *path);
+void archive_segment_close(struct archive_segment *segment);
+int archive_segment_entry(const struct archive_segment *segment, uint32_t n, struct archive_index_entry *entry);
+int64_t archive_segment_next(const struct archive_segment *segment, int64_t offset, struct archive_block_header *block);
+int archive_block_decode(const struct archive_segment *segment, int64_t offset,
+						 const struct archive_block_header *block, int64_t *ts, int32_t *rtt);
@@ -8,5 +8,7 @@
 #define WATCHDOG_IP "127.0.0.1"
 #define WATCHDOG_PORT 3000
 #define WATCHDOG_TIMEOUT_IN_MS (100 * 1000) 
+#define WATCHDOG_LIMIT_IN_S 10 // seconds without a sign before the watchdog ends the program
+#define WATCHDOG_FEED_IN_NS (1000 * 1000 * 1000LL) // the watchdog reads at most one sign per second
 
 #define PING_TIMEOUT_IN_MS (1000 * 1000) 
@@ -0,0 +1,416 @@
+// Loopback benchmark of the safe_ping program (partB), prints the results as JSON.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "defines.h"
+#include "stats.h"
+#include "rto.h"
+#include "ring.h"
+#include "archive.h"
+
+#define BENCH_DEFAULT_SECONDS 2
+#define BENCH_DEFAULT_INTERVAL_IN_MS 10
+#define BENCH_STARTUP_TIMEOUT_IN_MS (5 * 1000)
+#define BENCH_PROBER "./partB"
+
+// Stages of the probe lifecycle, as differences between the trace timestamps of partB.
+enum bench_stage
+{
+	STAGE_SCHEDULE_TO_SENT,	  // timer lateness and packet building
+	STAGE_SENT_TO_KERNEL_RX,  // the kernel's round trip (send syscall included)
+	STAGE_KERNEL_RX_TO_PARSED, // the prober's receive path: its self-added latency
+	STAGE_PARSED_TO_REPORTED, // printing and publishing the result
+	STAGE_SENT_TO_PARSED,	  // the RTT as measured by the prober
+	STAGES
+};
+
+// Everything measured on one run of the prober.
+struct run
+{
+	double startup_ms; // from fork() to the first printed reply, -1 if it never came
+	uint64_t replies;  // printed replies
+	int64_t first_reply, last_reply;
+	long rss_bytes; // resident set size of the prober just before it was stopped
+	double cpu_us;	// user + system CPU time of the prober
+	bool has_stats;
+	struct ping_stats stats;
+	int64_t *samples[STAGES]; // nanoseconds, one entry per traced probe
+	unsigned int nsamples;
+};
+
+int run_prober(char *const args[], double seconds, struct run *run);
+void parse_dump(char *dump, struct run *run);
+long rss_of(pid_t pid);
+int compare_i64(const void *a, const void *b);
+void print_stats(const char *indent, const char *name, int64_t *values, unsigned int n, bool last);
+int main(int argc, char *argv[]);
+
+/**
+ * @brief The main function
+ * Runs the real prober (./partB) twice against loopback addresses, with its trace on (-t) and
+ * every output enabled (-r ring, -a archive):
+ *  - back to back probes (-i 0), for the throughput, the CPU per probe and the per-stage latencies,
+ *  - paced probes (-i <interval>), for the timer lateness of the inter-probe sleep.
+ * The latencies come from partB's own trace, that is read back with SIGUSR1.
+ *
+ * @param argc number of arguments
+ * @param argv arguments: [-d seconds per run] [-i paced interval in ms]
+ * @return int 0 if no error
+ */
+int main(int argc, char *argv[])
+{
+	double seconds = BENCH_DEFAULT_SECONDS;
+	int interval_ms = BENCH_DEFAULT_INTERVAL_IN_MS, opt;
+
+	while ((opt = getopt(argc, argv, "d:i:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			seconds = atof(optarg);
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-d seconds per run] [-i paced interval in ms]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (seconds <= 0 || interval_ms <= 0)
+	{
+		fprintf(stderr, "Invalid arguments\n");
+		exit(1);
+	}
+	if (access(BENCH_PROBER, X_OK) == -1)
+	{
+		perror(BENCH_PROBER);
+		exit(errno);
+	}
+
+	char ring_name[64], archive_dir[64], interval[16];
+	snprintf(ring_name, sizeof(ring_name), "/pingbench-%d", getpid());
+	snprintf(archive_dir, sizeof(archive_dir), "/tmp/pingbench-%d", getpid());
+	snprintf(interval, sizeof(interval), "%d", interval_ms);
+
+	struct run fast, paced;
+	char *fast_args[] = {BENCH_PROBER, "-t", "-r", ring_name, "-a", archive_dir, "-i", "0", "127.0.0.1", NULL};
+	char *paced_args[] = {BENCH_PROBER, "-t", "-r", ring_name, "-a", archive_dir, "-i", interval, "127.0.0.2", NULL};
+
+	if (run_prober(fast_args, seconds, &fast) == -1 || run_prober(paced_args, seconds, &paced) == -1)
+		exit(1);
+
+	// The outputs were only there to be exercised.
+	char command[128];
+	snprintf(command, sizeof(command), "rm -rf %s", archive_dir);
+	if (system(command) != 0)
+		fprintf(stderr, "Could not remove %s\n", archive_dir);
+	shm_unlink(ring_name);
+
+	double span = (fast.last_reply - fast.first_reply) / 1e9;
+	size_t ring_bytes = sizeof(struct ring_header) + (size_t)RING_DEFAULT_CAPACITY * sizeof(struct ring_slot);
+
+	printf("{\n");
+	printf("  \"bench\": \"partB-loopback\",\n");
+	printf("  \"seconds_per_run\": %.3f,\n", seconds);
+	printf("  \"startup_to_first_probe_ms\": %.3f,\n", fast.startup_ms);
+	printf("  \"throughput\": {\n");
+	printf("    \"target\": \"127.0.0.1\",\n");
+	printf("    \"replies\": %lu,\n", fast.replies);
+	printf("    \"probes_per_sec\": %.1f,\n", fast.replies > 1 && span > 0 ? (fast.replies - 1) / span : 0.0);
+	printf("    \"cpu_us_per_probe\": %.3f,\n", fast.replies ? fast.cpu_us / fast.replies : 0.0);
+	printf("    \"syscalls_per_probe\": %.2f,\n", fast.replies ? (double)fast.stats.syscalls / fast.replies : 0.0);
+	printf("    \"eagain\": %lu,\n", fast.stats.eagains);
+	printf("    \"drops\": %lu,\n", fast.stats.drops);
+	printf("    \"parse_rejects\": %lu,\n", fast.stats.parse_rejects);
+	printf("    \"send_errors\": %lu,\n", fast.stats.send_errors);
+	print_stats("    ", "rtt_user_us", fast.samples[STAGE_SENT_TO_PARSED], fast.nsamples, false);
+	print_stats("    ", "rtt_kernel_us", fast.samples[STAGE_SENT_TO_KERNEL_RX], fast.nsamples, false);
+	print_stats("    ", "self_added_latency_us", fast.samples[STAGE_KERNEL_RX_TO_PARSED], fast.nsamples, false);
+	print_stats("    ", "reporting_us", fast.samples[STAGE_PARSED_TO_REPORTED], fast.nsamples, true);
+	printf("  },\n");
+	printf("  \"paced\": {\n");
+	printf("    \"target\": \"127.0.0.2\",\n");
+	printf("    \"interval_ms\": %d,\n", interval_ms);
+	printf("    \"replies\": %lu,\n", paced.replies);
+	printf("    \"timer_late\": %lu,\n", paced.stats.timer_late);
+	printf("    \"timer_late_avg_us\": %.1f,\n",
+		   paced.stats.timer_late ? paced.stats.timer_late_ns / 1e3 / paced.stats.timer_late : 0.0);
+	printf("    \"timer_late_max_us\": %.1f,\n", paced.stats.timer_late_max_ns / 1e3);
+	print_stats("    ", "schedule_to_sent_us", paced.samples[STAGE_SCHEDULE_TO_SENT], paced.nsamples, true);
+	printf("  },\n");
+	printf("  \"memory\": {\n");
+	printf("    \"prober_rss_bytes\": %ld,\n", fast.rss_bytes);
+	printf("    \"rto_bytes\": %zu,\n", sizeof(struct rto));
+	printf("    \"trace_bytes\": %zu,\n", sizeof(struct trace_record) * TRACE_SIZE);
+	printf("    \"archive_bytes\": %zu,\n", sizeof(struct archive));
+	printf("    \"ring_bytes\": %zu\n", ring_bytes);
+	printf("  }\n");
+	printf("}\n");
+
+	for (int i = 0; i < STAGES; i++)
+	{
+		free(fast.samples[i]);
+		free(paced.samples[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief run_prober() runs the prober for some time, then reads back its stats and trace.
+ * The prober runs in its own process group, so its watchdog can be killed along with it.
+ *
+ * @param args - the prober's command line.
+ * @param seconds - how long to let it probe, after its first reply.
+ * @param run - the measurements.
+ * @return int 0 if sucsesfull, -1 if the prober never replied.
+ */
+int run_prober(char *const args[], double seconds, struct run *run)
+{
+	int out[2], err[2];
+
+	memset(run, 0, sizeof(*run));
+	run->startup_ms = -1;
+	if (pipe(out) == -1 || pipe(err) == -1)
+	{
+		perror("pipe");
+		return -1;
+	}
+
+	int64_t start = mono_ns();
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0)
+	{
+		setpgid(0, 0);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+		close(out[0]);
+		close(out[1]);
+		close(err[0]);
+		close(err[1]);
+		execv(args[0], args);
+		_exit(127);
+	}
+	setpgid(pid, pid);
+	close(out[1]);
+	close(err[1]);
+
+	char line[1024], chunk[4096];
+	size_t used = 0, dump_len = 0, dump_cap = 64 * 1024;
+	char *dump = malloc(dump_cap);
+	struct pollfd fds[2] = {{.fd = out[0], .events = POLLIN}, {.fd = err[0], .events = POLLIN}};
+	int64_t stop_at = start + BENCH_STARTUP_TIMEOUT_IN_MS * 1000000LL;
+	bool stopping = false, exited = false;
+	struct rusage ru;
+	int status;
+
+	// Until both pipes are closed: count the replies, collect stderr, and stop the prober when it is time.
+	while (fds[0].fd != -1 || fds[1].fd != -1)
+	{
+		if (!stopping && mono_ns() >= stop_at)
+		{
+			// The dump and the stop signals are both handled at the prober's next wait, in that order.
+			run->rss_bytes = rss_of(pid);
+			kill(pid, SIGUSR1);
+			kill(pid, SIGTERM);
+			stopping = true;
+		}
+		if (!exited && wait4(pid, &status, WNOHANG, &ru) == pid)
+		{
+			// The watchdog still holds the pipes open.
+			exited = true;
+			kill(-pid, SIGKILL);
+		}
+
+		if (poll(fds, 2, 10) <= 0)
+			continue;
+
+		if (fds[1].revents != 0)
+		{
+			ssize_t r = read(err[0], chunk, sizeof(chunk));
+			if (r <= 0)
+			{
+				fds[1].fd = -1;
+				continue;
+			}
+			if (dump_len + r + 1 > dump_cap)
+				dump = realloc(dump, dump_cap = 2 * (dump_len + r + 1));
+			memcpy(dump + dump_len, chunk, r);
+			dump_len += r;
+		}
+		if (fds[0].revents != 0)
+		{
+			ssize_t r = read(out[0], chunk, sizeof(chunk));
+			if (r <= 0)
+			{
+				fds[0].fd = -1;
+				continue;
+			}
+			for (ssize_t i = 0; i < r; i++)
+			{
+				if (chunk[i] != '\n')
+				{
+					if (used < sizeof(line) - 1)
+						line[used++] = chunk[i];
+					continue;
+				}
+				line[used] = '\0';
+				used = 0;
+				if (strstr(line, "bytes from") == NULL)
+					continue;
+
+				int64_t now = mono_ns();
+				if (run->replies++ == 0)
+				{
+					run->startup_ms = (now - start) / 1e6;
+					run->first_reply = now;
+					stop_at = now + (int64_t)(seconds * 1e9);
+				}
+				run->last_reply = now;
+			}
+		}
+	}
+	if (!exited)
+	{
+		wait4(pid, &status, 0, &ru);
+		kill(-pid, SIGKILL);
+	}
+	close(out[0]);
+	close(err[0]);
+
+	run->cpu_us = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+	dump[dump_len] = '\0';
+	parse_dump(dump, run);
+	free(dump);
+
+	if (run->replies == 0)
+	{
+		fprintf(stderr, "%s never replied\n", args[0]);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief parse_dump() reads the stats line and the trace lines printed by the prober on SIGUSR1.
+ *
+ * @param dump - the prober's stderr.
+ * @param run - the measurements.
+ */
+void parse_dump(char *dump, struct run *run)
+{
+	for (int i = 0; i < STAGES; i++)
+		run->samples[i] = malloc(TRACE_SIZE * sizeof(int64_t));
+
+	for (char *line = strtok(dump, "\n"); line != NULL; line = strtok(NULL, "\n"))
+	{
+		struct ping_stats *s = &run->stats;
+		double late_avg, late_max, sent, kernel_rx, parsed, reported;
+		unsigned int seq;
+		long sec, usec;
+
+		if (sscanf(line,
+				   "stats: syscalls=%lu eagain=%lu drops=%lu parse_rejects=%lu send_errors=%lu timer_late=%lu "
+				   "timer_late_avg_us=%lf timer_late_max_us=%lf",
+				   &s->syscalls, &s->eagains, &s->drops, &s->parse_rejects, &s->send_errors, &s->timer_late, &late_avg,
+				   &late_max) == 8)
+		{
+			s->timer_late_ns = late_avg * 1e3 * s->timer_late;
+			s->timer_late_max_ns = late_max * 1e3;
+			run->has_stats = true;
+		}
+		// Probes with a missing stage (lost, or still in flight when stopped) do not parse and are skipped.
+		else if (run->nsamples < TRACE_SIZE &&
+				 sscanf(line, "trace: seq=%u scheduled=%ld.%ld sent=+%lfus kernel_rx=+%lfus parsed=+%lfus reported=+%lfus",
+						&seq, &sec, &usec, &sent, &kernel_rx, &parsed, &reported) == 7)
+		{
+			unsigned int n = run->nsamples++;
+			run->samples[STAGE_SCHEDULE_TO_SENT][n] = sent * 1e3;
+			run->samples[STAGE_SENT_TO_KERNEL_RX][n] = (kernel_rx - sent) * 1e3;
+			run->samples[STAGE_KERNEL_RX_TO_PARSED][n] = (parsed - kernel_rx) * 1e3;
+			run->samples[STAGE_PARSED_TO_REPORTED][n] = (reported - parsed) * 1e3;
+			run->samples[STAGE_SENT_TO_PARSED][n] = (parsed - sent) * 1e3;
+		}
+	}
+
+	if (!run->has_stats)
+		fprintf(stderr, "The prober printed no stats\n");
+}
+
+/**
+ * @brief rss_of() reads the resident set size of a process from /proc.
+ *
+ * @param pid - the process.
+ * @return long - the resident set size in bytes, 0 if unknown.
+ */
+long rss_of(pid_t pid)
+{
+	char path[64];
+	long pages = 0, resident = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return 0;
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief compare_i64() compares two int64_t for qsort().
+ */
+int compare_i64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief print_stats() prints mean/p50/p99/max of nanosecond samples as a JSON object in microseconds.
+ *
+ * @param indent - the indentation.
+ * @param name - the JSON key.
+ * @param values - the samples, sorted in place.
+ * @param n - the number of samples.
+ * @param last - true if this is the last member of the enclosing object.
+ */
+void print_stats(const char *indent, const char *name, int64_t *values, unsigned int n, bool last)
+{
+	if (n == 0)
+	{
+		printf("%s\"%s\": null%s\n", indent, name, last ? "" : ",");
+		return;
+	}
+
+	double sum = 0;
+	qsort(values, n, sizeof(int64_t), compare_i64);
+	for (unsigned int i = 0; i < n; i++)
+		sum += values[i];
+
+	printf("%s\"%s\": {\"samples\": %u, \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n", indent, name,
+		   n, sum / n / 1e3, values[n / 2] / 1e3, values[(n - 1) * 99 / 100] / 1e3, values[n - 1] / 1e3,
+		   last ? "" : ",");
+}
@@ -0,0 +1,216 @@
+// Program that computes loss and RTT percentiles out of archived probe results.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "archive.h"
+
+// Results of one target within the window.
+struct summary
+{
+	uint32_t target;
+	uint64_t probes;
+	uint64_t lost;
+	int32_t *rtt; // RTTs of the answered probes
+	size_t nrtt, capacity;
+};
+
+int parse_time(const char *arg, int64_t *us);
+int add_block(struct summary *summary, const struct archive_segment *segment, int64_t offset,
+			  const struct archive_block_header *block, int64_t from, int64_t to);
+int compare_i32(const void *a, const void *b);
+int main(int argc, char *argv[]);
+
+/**
+ * @brief The main function
+ * Maps every segment and only decodes the blocks that overlap the window: complete segments are
+ * filtered through their index footer, the others by walking their block headers.
+ *
+ * @param argc number of arguments
+ * @param argv arguments: [-s start] [-e end] <segment>..., times are seconds since the epoch,
+ * or negative seconds relative to now (-s -3600 is the last hour)
+ * @return int the error number 0 if no error
+ */
+int main(int argc, char *argv[])
+{
+	int64_t from = INT64_MIN, to = INT64_MAX;
+	struct summary *summaries = NULL;
+	size_t nsummaries = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:e:")) != -1)
+	{
+		if ((opt != 's' && opt != 'e') || parse_time(optarg, opt == 's' ? &from : &to) == -1)
+		{
+			fprintf(stderr, "Usage: %s [-s start] [-e end] <segment>...\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (optind == argc)
+	{
+		fprintf(stderr, "Usage: %s [-s start] [-e end] <segment>...\n", argv[0]);
+		exit(1);
+	}
+
+	for (int i = optind; i < argc; i++)
+	{
+		struct archive_segment segment;
+		struct archive_block_header block;
+
+		if (archive_segment_open(&segment, argv[i]) == -1)
+		{
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+			continue;
+		}
+
+		// Results are grouped by target.
+		struct summary *summary = NULL;
+		for (size_t j = 0; j < nsummaries; j++)
+		{
+			if (summaries[j].target == segment.target)
+				summary = &summaries[j];
+		}
+		if (summary == NULL)
+		{
+			summaries = realloc(summaries, (nsummaries + 1) * sizeof(struct summary));
+			if (summaries == NULL)
+			{
+				perror("realloc");
+				exit(errno);
+			}
+			summary = &summaries[nsummaries++];
+			memset(summary, 0, sizeof(*summary));
+			summary->target = segment.target;
+		}
+
+		if (segment.nblocks > 0)
+		{
+			struct archive_index_entry entry;
+			for (uint32_t n = 0; archive_segment_entry(&segment, n, &entry) == 0; n++)
+			{
+				if (entry.last < from || entry.first > to)
+					continue;
+				if (archive_segment_next(&segment, entry.offset, &block) == -1 ||
+					add_block(summary, &segment, entry.offset, &block, from, to) == -1)
+					fprintf(stderr, "%s: corrupt block at %ld\n", argv[i], entry.offset);
+			}
+		}
+		else
+		{
+			// No footer (the prober did not close the segment): walk the block headers.
+			int64_t offset = sizeof(struct archive_file_header), next;
+			while ((next = archive_segment_next(&segment, offset, &block)) != -1)
+			{
+				if (block.last >= from && block.first <= to &&
+					add_block(summary, &segment, offset, &block, from, to) == -1)
+					fprintf(stderr, "%s: corrupt block at %ld\n", argv[i], offset);
+				offset = next;
+			}
+		}
+
+		archive_segment_close(&segment);
+	}
+
+	for (size_t j = 0; j < nsummaries; j++)
+	{
+		struct summary *summary = &summaries[j];
+		char space[INET_ADDRSTRLEN];
+
+		inet_ntop(AF_INET, &summary->target, space, INET_ADDRSTRLEN);
+		printf("%s: %lu probes, %lu lost (%.3f%%)\n", space, summary->probes, summary->lost,
+			   summary->probes ? 100.0 * summary->lost / summary->probes : 0.0);
+
+		if (summary->nrtt > 0)
+		{
+			size_t n = summary->nrtt;
+			qsort(summary->rtt, n, sizeof(int32_t), compare_i32);
+			printf("	rtt min/p50/p90/p99/max = %.3f/%.3f/%.3f/%.3f/%.3f ms\n", summary->rtt[0] / 1000.0,
+				   summary->rtt[(n - 1) * 50 / 100] / 1000.0, summary->rtt[(n - 1) * 90 / 100] / 1000.0,
+				   summary->rtt[(n - 1) * 99 / 100] / 1000.0, summary->rtt[n - 1] / 1000.0);
+		}
+		free(summary->rtt);
+	}
+	free(summaries);
+
+	return 0;
+}
+
+/**
+ * @brief parse_time() parses a window bound.
+ *
+ * @param arg - seconds since the epoch, or negative seconds relative to now.
+ * @param us - the bound in us since the epoch.
+ * @return int 0 if sucsesfull, -1 if the argument is not a number.
+ */
+int parse_time(const char *arg, int64_t *us)
+{
+	char *end;
+	double seconds = strtod(arg, &end);
+
+	if (end == arg || *end != '\0')
+		return -1;
+	if (seconds < 0)
+		seconds += time(NULL);
+	*us = (int64_t)(seconds * 1e6);
+
+	return 0;
+}
+
+/**
+ * @brief add_block() decodes a block and accounts its results that are within the window.
+ *
+ * @param summary - the target's results.
+ * @param segment - the segment.
+ * @param offset - the offset of the block header.
+ * @param block - the block header.
+ * @param from - the start of the window, us since the epoch.
+ * @param to - the end of the window.
+ * @return int 0 if sucsesfull, -1 if the block is corrupt.
+ */
+int add_block(struct summary *summary, const struct archive_segment *segment, int64_t offset,
+			  const struct archive_block_header *block, int64_t from, int64_t to)
+{
+	int64_t ts[ARCHIVE_BLOCK_RECORDS];
+	int32_t rtt[ARCHIVE_BLOCK_RECORDS];
+
+	if (archive_block_decode(segment, offset, block, ts, rtt) == -1)
+		return -1;
+
+	if (summary->nrtt + block->count > summary->capacity)
+	{
+		summary->capacity = summary->capacity ? summary->capacity * 2 : 4096;
+		summary->rtt = realloc(summary->rtt, summary->capacity * sizeof(int32_t));
+		if (summary->rtt == NULL)
+		{
+			perror("realloc");
+			exit(errno);
+		}
+	}
+
+	for (uint32_t i = 0; i < block->count; i++)
+	{
+		if (ts[i] < from || ts[i] > to)
+			continue;
+		summary->probes++;
+		if (rtt[i] == ARCHIVE_LOST)
+			summary->lost++;
+		else
+			summary->rtt[summary->nrtt++] = rtt[i];
+	}
+
+	return 0;
+}
+
+/**
+ * @brief compare_i32() compares two int32_t for qsort().
+ */
+int compare_i32(const void *a, const void *b)
+{
+	int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+	return (x > y) - (x < y);
+}
@@ -0,0 +1,262 @@
+// Shared memory ring of probe results: writer and reader library.
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ring.h"
+
+static int lock_writer(int fd);
+
+/**
+ * @brief ring_create() creates (or reopens) the ring /dev/shm/<name> for writing.
+ * An existing ring with the same layout is continued, so attached readers survive a restart of the prober.
+ * An incompatible one is unlinked and replaced, never resized: its readers keep their (now idle) mapping.
+ * The segment stays locked (flock) while the ring is open, as the seqlock allows a single writer.
+ *
+ * @param name - the shared memory name, e.g. "/ping".
+ * @param capacity - the number of records, a power of 2.
+ * @return struct ring* - the ring, NULL if failed (errno is set, EBUSY if another writer has it).
+ */
+struct ring *ring_create(const char *name, uint32_t capacity)
+{
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	size_t size = sizeof(struct ring_header) + (size_t)capacity * sizeof(struct ring_slot);
+	struct ring_header *header = MAP_FAILED;
+	struct stat st;
+
+	// Reuse the existing segment only if no one else writes it and it has exactly our layout.
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd != -1)
+	{
+		if (lock_writer(fd) == -1)
+			return NULL;
+		if (fstat(fd, &st) == 0 && (size_t)st.st_size == size)
+			header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+		if (header != MAP_FAILED &&
+			(header->magic != RING_MAGIC || header->version != RING_VERSION ||
+			 header->record_size != sizeof(struct ring_record) || header->capacity != capacity))
+		{
+			munmap(header, size);
+			header = MAP_FAILED;
+		}
+		if (header == MAP_FAILED)
+		{
+			close(fd);
+			if (shm_unlink(name) == -1)
+				return NULL;
+		}
+	}
+
+	if (header == MAP_FAILED)
+	{
+		// New segment, zero filled by ftruncate(): the magic is written last, readers wait for it.
+		// It is locked before anything else, another writer that opens it meanwhile gets EBUSY.
+		if ((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644)) == -1)
+		{
+			if (errno == EEXIST)
+				errno = EBUSY; // created by another writer since it was unlinked
+			return NULL;
+		}
+		if (lock_writer(fd) == -1)
+			return NULL;
+		if (ftruncate(fd, size) == -1 ||
+			(header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		{
+			int error = errno;
+			close(fd);
+			shm_unlink(name);
+			errno = error;
+			return NULL;
+		}
+
+		header->version = RING_VERSION;
+		header->record_size = sizeof(struct ring_record);
+		header->capacity = capacity;
+		atomic_thread_fence(memory_order_release);
+		header->magic = RING_MAGIC;
+	}
+
+	struct ring *ring = malloc(sizeof(struct ring));
+	if (ring == NULL)
+	{
+		munmap(header, size);
+		close(fd);
+		return NULL;
+	}
+	ring->header = header;
+	ring->size = size;
+	ring->capacity = capacity;
+	ring->fd = fd;
+
+	return ring;
+}
+
+/**
+ * @brief lock_writer() takes the writer lock of a ring segment, without waiting.
+ *
+ * @param fd - the shared memory segment, closed if the lock is not taken.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set, EBUSY if another writer holds it).
+ */
+static int lock_writer(int fd)
+{
+	if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+		return 0;
+
+	int error = errno == EWOULDBLOCK ? EBUSY : errno;
+	close(fd);
+	errno = error;
+	return -1;
+}
+
+/**
+ * @brief ring_publish() appends a record, overwriting the oldest one when the ring is full.
+ *
+ * @param ring - the ring.
+ * @param record - the record to append.
+ */
+void ring_publish(struct ring *ring, const struct ring_record *record)
+{
+	struct ring_header *header = ring->header;
+	uint64_t pos = atomic_load_explicit(&header->head, memory_order_relaxed); // single writer
+	struct ring_slot *slot = &header->slots[pos & (ring->capacity - 1)];
+
+	atomic_store_explicit(&slot->seq, 2 * pos + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot->record = *record;
+	atomic_store_explicit(&slot->seq, 2 * pos + 2, memory_order_release);
+	atomic_store_explicit(&header->head, pos + 1, memory_order_release);
+}
+
+/**
+ * @brief ring_close() unmaps the ring and releases the writer lock, the segment stays for its readers.
+ *
+ * @param ring - the ring.
+ */
+void ring_close(struct ring *ring)
+{
+	if (ring == NULL)
+		return;
+	munmap(ring->header, ring->size);
+	close(ring->fd);
+	free(ring);
+}
+
+/**
+ * @brief ring_attach() maps the ring /dev/shm/<name> for reading.
+ *
+ * @param reader - the reader to set up.
+ * @param name - the shared memory name.
+ * @param from_oldest - 1 to start at the oldest record still in the ring, 0 to start at the next new one.
+ * @return int 0 if sucsesfull, -1 if failed (errno is set).
+ */
+int ring_attach(struct ring_reader *reader, const char *name, int from_oldest)
+{
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(struct ring_header))
+	{
+		close(fd);
+		errno = EPROTO;
+		return -1;
+	}
+
+	struct ring_header *header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (header == MAP_FAILED)
+		return -1;
+
+	uint32_t capacity = header->capacity; // read once, then only the private copy is used
+	if (header->magic != RING_MAGIC || header->version != RING_VERSION ||
+		header->record_size != sizeof(struct ring_record) || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+		sizeof(struct ring_header) + (size_t)capacity * sizeof(struct ring_slot) > (size_t)st.st_size)
+	{
+		munmap(header, st.st_size);
+		errno = EPROTO;
+		return -1;
+	}
+	atomic_thread_fence(memory_order_acquire);
+
+	uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+	reader->header = header;
+	reader->size = st.st_size;
+	reader->capacity = capacity;
+	reader->lost = 0;
+	reader->pos = head;
+	if (from_oldest)
+		reader->pos = head > reader->capacity ? head - reader->capacity : 0;
+
+	return 0;
+}
+
+/**
+ * @brief ring_read() copies the next record, without any system call.
+ *
+ * @param reader - the reader.
+ * @param record - the buffer to copy the record to.
+ * @return int 1 if a record was read, 0 if there is no new record.
+ */
+int ring_read(struct ring_reader *reader, struct ring_record *record)
+{
+	struct ring_header *header = reader->header;
+
+	while (reader->pos < atomic_load_explicit(&header->head, memory_order_acquire))
+	{
+		struct ring_slot *slot = &header->slots[reader->pos & (reader->capacity - 1)];
+		uint64_t expected = 2 * reader->pos + 2;
+		uint64_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+		if (before == expected)
+		{
+			*record = slot->record;
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == expected)
+			{
+				reader->pos++;
+				return 1;
+			}
+		}
+		else if (before < expected)
+			return 0; // published head but the slot is still being written: try again later.
+
+		// Lapped by the writer: jump to the oldest record that is still in the ring.
+		uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+		uint64_t oldest = head > reader->capacity ? head - reader->capacity : 0;
+		if (oldest <= reader->pos)
+			oldest = reader->pos + 1;
+		reader->lost += oldest - reader->pos;
+		reader->pos = oldest;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief ring_detach() unmaps the ring.
+ *
+ * @param reader - the reader.
+ */
+void ring_detach(struct ring_reader *reader)
+{
+	munmap(reader->header, reader->size);
+	reader->header = NULL;
+}
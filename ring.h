@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/**
+ * Shared memory ring of probe results (/dev/shm/<name>), one writer and any number of readers.
+ *
+ * Every slot is protected by its own sequence number (a seqlock): the writer marks the slot busy,
+ * fills it, then publishes it with the position it holds. A reader that gets lapped by the writer
+ * notices it from the sequence number and skips ahead, so readers never slow the prober down and
+ * reading a record needs no system call.
+ */
+
+#define RING_MAGIC 0x474e5250 // "PRNG"
+#define RING_VERSION 1
+#define RING_DEFAULT_CAPACITY 4096 // records, must be a power of 2
+
+#define RING_REPLY 0 // the probe got its ECHO REPLY
+#define RING_LOST 1	 // the probe got no reply in time
+
+struct ring_record
+{
+	int64_t ts_ns;	 // time the probe was sent, nanoseconds since the epoch
+	uint32_t target; // IPv4 address of the target, network order
+	uint32_t seq;	 // probe sequence number
+	uint32_t rtt_us; // round trip time, 0 if lost
+	uint16_t bytes;	 // bytes received
+	uint8_t ttl;
+	uint8_t status; // RING_REPLY or RING_LOST
+};
+
+struct ring_slot
+{
+	_Atomic uint64_t seq; // 2 * position + 2 once published, odd while being written
+	struct ring_record record;
+};
+
+struct ring_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t capacity;
+	char pad[48];
+	_Atomic uint64_t head; // next position to be written, alone in its cache line
+	char pad2[56];
+	struct ring_slot slots[];
+};
+
+// Writer side.
+struct ring
+{
+	struct ring_header *header;
+	size_t size;
+	uint32_t capacity;
+	int fd; // kept open for the writer lock
+};
+
+// Reader side, every reader keeps its own position.
+struct ring_reader
+{
+	struct ring_header *header; // mapped read only
+	size_t size;
+	uint32_t capacity; // checked against the mapping size at attach time
+	uint64_t pos;
+	uint64_t lost; // records overwritten before this reader got to them
+};
+
+struct ring *ring_create(const char *name, uint32_t capacity);
+void ring_publish(struct ring *ring, const struct ring_record *record);
+void ring_close(struct ring *ring);
+
+int ring_attach(struct ring_reader *reader, const char *name, int from_oldest);
+int ring_read(struct ring_reader *reader, struct ring_record *record);
+void ring_detach(struct ring_reader *reader);
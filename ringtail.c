@@ -0,0 +1,85 @@
+// Program that prints the probe results published by safe_ping into a shared memory ring.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "ring.h"
+
+#define RINGTAIL_IDLE_IN_NS (1000 * 1000) // sleep between checks when the ring has nothing new
+
+int main(int argc, char *argv[]);
+
+/**
+ * @brief The main function
+ * Follows the ring like "tail -f": records are read straight from the shared memory, the program
+ * only sleeps (one system call) when there is nothing new to read.
+ *
+ * @param argc number of arguments
+ * @param argv arguments: [-a] <name>, -a starts from the oldest record still in the ring
+ * @return int the error number 0 if no error
+ */
+int main(int argc, char *argv[])
+{
+	struct ring_reader reader;
+	struct ring_record record;
+	const struct timespec idle = {.tv_sec = 0, .tv_nsec = RINGTAIL_IDLE_IN_NS};
+	char space[INET_ADDRSTRLEN];
+	uint64_t lost = 0;
+	int from_oldest = 0, opt;
+
+	while ((opt = getopt(argc, argv, "a")) != -1)
+	{
+		if (opt == 'a')
+			from_oldest = 1;
+		else
+		{
+			fprintf(stderr, "Usage: %s [-a] <name>\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (argc - optind != 1)
+	{
+		fprintf(stderr, "Usage: %s [-a] <name>\n", argv[0]);
+		exit(1);
+	}
+
+	if (ring_attach(&reader, argv[optind], from_oldest) == -1)
+	{
+		perror("ring_attach");
+		exit(errno);
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	while (true)
+	{
+		if (!ring_read(&reader, &record))
+		{
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		if (reader.lost != lost)
+		{
+			fprintf(stderr, "ringtail: %lu records overwritten before they were read\n", reader.lost - lost);
+			lost = reader.lost;
+		}
+
+		inet_ntop(AF_INET, &record.target, space, INET_ADDRSTRLEN);
+		if (record.status == RING_LOST)
+			printf("%ld.%06ld %s icmp_seq=%u lost\n", record.ts_ns / 1000000000L, (record.ts_ns % 1000000000L) / 1000,
+				   space, record.seq);
+		else
+			printf("%ld.%06ld %s icmp_seq=%u bytes=%u ttl=%u time=%0.3f ms\n", record.ts_ns / 1000000000L,
+				   (record.ts_ns % 1000000000L) / 1000, space, record.seq, record.bytes, record.ttl,
+				   record.rtt_us / 1000.0);
+	}
+
+	ring_detach(&reader);
+	return 0;
+}
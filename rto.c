@@ -0,0 +1,75 @@
+// Adaptive probe timeout (RFC 6298) and probe backoff of unreachable targets.
+
+#include "rto.h"
+
+/**
+ * @brief rto_init() sets the state of a target that was never measured.
+ *
+ * @param rto - the target's state.
+ */
+void rto_init(struct rto *rto)
+{
+	rto->has_sample = false;
+	rto->srtt = 0;
+	rto->rttvar = 0;
+	rto->timeout = RTO_INITIAL_IN_US;
+	rto->backoff = 0;
+}
+
+/**
+ * @brief rto_sample() updates SRTT, RTTVAR and RTO with a new RTT measurement (RFC 6298, 2.2 and 2.3).
+ * A reply ends the backoff at once.
+ *
+ * @param rto - the target's state.
+ * @param rtt - the measured round trip time in microseconds.
+ */
+void rto_sample(struct rto *rto, int64_t rtt)
+{
+	if (!rto->has_sample)
+	{
+		rto->srtt = rtt;
+		rto->rttvar = rtt / 2;
+		rto->has_sample = true;
+	}
+	else
+	{
+		int64_t delta = rto->srtt > rtt ? rto->srtt - rtt : rtt - rto->srtt;
+
+		rto->rttvar = (3 * rto->rttvar + delta) / 4; // beta = 1/4
+		rto->srtt = (7 * rto->srtt + rtt) / 8;		  // alpha = 1/8
+	}
+
+	int64_t var = 4 * rto->rttvar;
+	rto->timeout = rto->srtt + (var > RTO_GRANULARITY_IN_US ? var : RTO_GRANULARITY_IN_US);
+	if (rto->timeout < RTO_MIN_IN_US)
+		rto->timeout = RTO_MIN_IN_US;
+	if (rto->timeout > RTO_MAX_IN_US)
+		rto->timeout = RTO_MAX_IN_US;
+	rto->backoff = 0;
+}
+
+/**
+ * @brief rto_lost() backs the timer off after a lost probe (RFC 6298, 5.5) and slows the probing down.
+ *
+ * @param rto - the target's state.
+ */
+void rto_lost(struct rto *rto)
+{
+	rto->timeout *= 2;
+	if (rto->timeout > RTO_MAX_IN_US)
+		rto->timeout = RTO_MAX_IN_US;
+	if (rto->backoff < RTO_BACKOFF_MAX)
+		rto->backoff++;
+}
+
+/**
+ * @brief rto_interval() returns the time to wait before the next probe.
+ *
+ * @param rto - the target's state.
+ * @param base - the normal probe interval.
+ * @return int64_t - the base interval, doubled for every consecutive lost probe.
+ */
+int64_t rto_interval(const struct rto *rto, int64_t base)
+{
+	return base << rto->backoff;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Retransmission timeout of RFC 6298, used to declare a probe lost, in microseconds.
+#define RTO_INITIAL_IN_US (1000 * 1000)
+#define RTO_MIN_IN_US (10 * 1000) // lower than the RFC's 1 s, so fast links detect a loss fast
+#define RTO_MAX_IN_US (8 * 1000 * 1000)
+#define RTO_GRANULARITY_IN_US 1000 // G, the clock granularity
+#define RTO_BACKOFF_MAX 3		   // the probe interval grows up to 2^3 times while the target does not answer
+
+// Per-target timing state.
+struct rto
+{
+	bool has_sample; // false until the first RTT measurement
+	int64_t srtt;	 // smoothed round trip time
+	int64_t rttvar;	 // round trip time variation
+	int64_t timeout; // current RTO
+	int backoff;	 // consecutive lost probes, capped to RTO_BACKOFF_MAX
+};
+
+void rto_init(struct rto *rto);
+void rto_sample(struct rto *rto, int64_t rtt);
+void rto_lost(struct rto *rto);
+int64_t rto_interval(const struct rto *rto, int64_t base);
@@ -1,5 +1,7 @@
 // Program that work like origin "ping" with Timeout
 
+#define _GNU_SOURCE // ppoll()
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
@@ -9,7 +11,10 @@
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <time.h>
 #include <errno.h>
 #include <string.h>
@@ -17,17 +22,35 @@
 #include <stdbool.h>
 
 #include "defines.h"
+#include "stats.h"
+#include "ring.h"
+#include "rto.h"
+#include "archive.h"
 
 char dest[16]; // destination address ,16 is the max length of IPv4 address
 char end = '-'; // signal to end the watchdog 
 int watchdog_sock = -1;
 int pid;
+struct ring *ring = NULL; // shared memory results ring, only with -r
+struct archive *archive = NULL; // on-disk results archive, only with -a
+volatile sig_atomic_t stop = 0; // SIGINT / SIGTERM received
+sigset_t wait_mask; // signal mask while waiting: the stop and dump signals are only delivered there
+int timer_fd = -1; // absolute deadline of wait_for()
+int64_t watchdog_fed = 0; // time of the last sign sent to the watchdog
 
 int non_blocking(int sock);
 ssize_t send_packet(int sock, void *buffer, int length);
 ssize_t receive_packet(int sock, void *buffer, int lenght);
 unsigned short calculate_checksum(unsigned short *paddress, int len);
-ssize_t receiveICMP(int sock, void *response, int response_len, struct sockaddr_in *dest_in, socklen_t *lenght);
+ssize_t receiveICMP(int sock, void *response, int response_len, struct sockaddr_in *dest_in, socklen_t *lenght,
+					uint16_t seq, int64_t deadline);
+void check_watchdog(void);
+void feed_watchdog(void);
+void wait_for(int sock, int64_t deadline);
+void sleep_until(int64_t deadline);
+void take_signals(void);
+void on_stop(int signum);
+void close_archive(void);
 int main(int argc, char *argv[]);
 
 /**
@@ -35,8 +58,12 @@ int main(int argc, char *argv[]);
  * 
  *
  * @param argc number of arguments
- * @param argv arguments
+ * @param argv arguments: [-t] [-r name] [-a dir] [-i ms] <destination>, -t keeps a trace of the last probes,
+ * -r also publishes every result into the shared memory ring /dev/shm/<name> (see ringtail),
+ * -a also records every result into the archive directory <dir> (see pingq),
+ * -i sets the interval between probes (1000 ms by default, at most 1249 ms so the watchdog is fed in time)
  * @return int the error number 0 if no error
+ * Sending SIGUSR1 prints the self-metrics (and the trace) to stderr.
  */
  
 int main(int argc, char *argv[])
@@ -46,7 +73,6 @@ int main(int argc, char *argv[])
 	char packet[IP_MAXPACKET];	  // Buffer to hold the ICMP packet.
 	char icmp_response[IP_MAXPACKET];  // Buffer to receive the ICMP response.
 	char space[INET_ADDRSTRLEN];	  // Buffer to hold the IP address.
-	char sign = '+';			 // sign to continue the watchdog
 
 
 	// Varibles setup
@@ -57,27 +83,60 @@ int main(int argc, char *argv[])
 	socklen_t addr_len;
 	ssize_t bytes_received = 0;
 	size_t datalen;
-	int status;
+	int status, opt;
 
 
 	char data[IP_MAXPACKET] = "This is the ping \n"; // Data to be sent with the ICMP packet.
     datalen = (strlen(data) + 1);		// Calculate the length of the data.
 
 	// Check the arguments passed to the program and check IP validity.
-	if (argc != 2)
+	char *ring_name = NULL, *archive_dir = NULL;
+	int64_t interval = PING_TIMEOUT_IN_MS; // Interval between probes, in us.
+	while ((opt = getopt(argc, argv, "tr:a:i:")) != -1)
+	{
+		if (opt == 't')
+			trace_enabled = true;
+		else if (opt == 'r')
+			ring_name = optarg;
+		else if (opt == 'a')
+			archive_dir = optarg;
+		else if (opt == 'i')
+		{
+			// Even at the longest interval (RTO_BACKOFF_MAX), the watchdog must hear from us in time.
+			long max_interval = (WATCHDOG_LIMIT_IN_S * 1000L - 1) >> RTO_BACKOFF_MAX;
+			char *end_ptr;
+			errno = 0;
+			long ms = strtol(optarg, &end_ptr, 10);
+			if (errno != 0 || end_ptr == optarg || *end_ptr != '\0' || ms < 0 || ms > max_interval)
+			{
+				fprintf(stderr, "Invalid interval: %s, must be 0 to %ld ms\n", optarg, max_interval);
+				fprintf(stderr, "Usage: %s [-t] [-r name] [-a dir] [-i ms] <destination>\n", argv[0]);
+				exit(1);
+			}
+			interval = ms * 1000LL;
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [-t] [-r name] [-a dir] [-i ms] <destination>\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (argc - optind != 1)
 	{
-		fprintf(stderr, "Usage: %s <destination>\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-t] [-r name] [-a dir] [-i ms] <destination>\n", argv[0]);
 		exit(1);
 	}
+	char *destination = argv[optind];
 	memset(&dest_in, 0, sizeof(dest_in));
-	if (inet_pton(AF_INET, argv[1], &dest_in.sin_addr) != 1) // Convert the IP address to binary form.
+	if (inet_pton(AF_INET, destination, &dest_in.sin_addr) != 1 || strlen(destination) >= sizeof(dest)) // Convert the IP address to binary form.
 	{
-		fprintf(stderr, "Invalid IP address: %s\n", argv[1]); // If the IP address is invalid, print an error message and exit.
+		fprintf(stderr, "Invalid IP address: %s\n", destination); // If the IP address is invalid, print an error message and exit.
 		exit(1);
 	}
 	dest_in.sin_family = AF_INET; // Set the destination address family to IPv4.
 	addr_len = sizeof(dest_in);	  // Set the size of the destination address.
-	strcpy(dest, argv[1]); // Copy the destination address to a global variable.
+	strcpy(dest, destination); // Copy the destination address to a global variable.
+	setvbuf(stdout, NULL, _IOLBF, 0); // Line buffered, so every reply reaches a pipe right away.
 	int socketfd = -1;
 	if ((socketfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP)) == -1) // Create a raw socket.
 	{
@@ -85,6 +144,33 @@ int main(int argc, char *argv[])
 		exit(errno);
 	}
 	non_blocking(socketfd);		   // Set the socket to non-blocking mode.
+
+	// Let the kernel report its receive queue drops, and the receive timestamps when tracing.
+	int enable = 1;
+	setsockopt(socketfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+	if (trace_enabled)
+		setsockopt(socketfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+	stats_install(SIGUSR1);
+
+	// Deadlines are armed as absolute times, a relative poll() timeout would add the kernel's slack to every wait.
+	// They are on the monotonic clock, so a step of the wall clock neither stalls the probing nor loses a probe.
+	if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)
+	{
+		perror("timerfd_create");
+		exit(errno);
+	}
+
+	if (ring_name != NULL && (ring = ring_create(ring_name, RING_DEFAULT_CAPACITY)) == NULL)
+	{
+		perror("ring_create");
+		exit(errno);
+	}
+	if (archive_dir != NULL && (archive = archive_open(archive_dir, dest_in.sin_addr.s_addr)) == NULL)
+	{
+		perror("archive_open");
+		exit(errno);
+	}
+
 	icmph.icmp_type = ICMP_ECHO; // Set the ICMP type to ECHO.
 	icmph.icmp_code = 0;		   // Set the ICMP code to 0.
 	icmph.icmp_id = getpid();	   // Set the ICMP ID to the process ID.
@@ -122,6 +208,23 @@ int main(int argc, char *argv[])
 
 	else // In parent process (ping).
 	{
+		// Stop cleanly on SIGINT / SIGTERM, so the buffered archive results reach the disk.
+		// They are blocked, with the dump signal, except while waiting in wait_for(): a signal that comes
+		// while the program is busy is delivered by the next wait instead of being missed by it.
+		struct sigaction sa;
+		sigset_t wait_signals;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = on_stop;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+		sigemptyset(&wait_signals);
+		sigaddset(&wait_signals, SIGINT);
+		sigaddset(&wait_signals, SIGTERM);
+		sigaddset(&wait_signals, SIGUSR1);
+		sigprocmask(SIG_BLOCK, &wait_signals, &wait_mask);
+		atexit(close_archive);
+
 		// Wait some time until the watchdog will prepare it's own TCP socket.
 		usleep(WATCHDOG_TIMEOUT_IN_MS);
 
@@ -138,19 +241,27 @@ int main(int argc, char *argv[])
 			exit(errno);
 		}
 
-		printf( "ping %s: %ld data bytes\n", argv[1], datalen); // Print the destination address and the data length.
+		printf( "ping %s: %ld data bytes\n", destination, datalen); // Print the destination address and the data length.
 		struct timeval start, end; // Start and end time of the ping.
 		int counter = 0;
 		float time = 0.0;
+		int64_t next = mono_ns(); // Scheduled time of the next probe (monotonic clock).
+		struct rto rto;			 // Adaptive timeout and backoff of the target.
+		rto_init(&rto);
 
 
 		while (true)
 		{
 
 			// Prepare the ICMP ECHO packet.
+			uint16_t seq = counter;
+			// The trace is on the wall clock, like the kernel's receive timestamps.
+			if (trace_enabled)
+				trace_mark(seq, TRACE_SCHEDULED, now_ns() - (mono_ns() - next));
 
 			bzero(packet, IP_MAXPACKET);
 			// Calculate the ICMP checksum.
+			icmph.icmp_seq = htons(seq);
 			icmph.icmp_cksum = 0;
 			memcpy(packet, &icmph, ICMP_HDRLEN);		 // Copy the ICMP header to the packet.
 			memcpy(packet + ICMP_HDRLEN, data, datalen); // Copy the data to the packet.
@@ -161,35 +272,81 @@ int main(int argc, char *argv[])
 			gettimeofday(&start, NULL);
 
 			// Send the ICMP ECHO packet to the destination address.
+			// Stamped before sendto(): on loopback the reply is already received when sendto() returns.
+			trace_mark(seq, TRACE_SENT, 0);
 			ssize_t bytes_sent = sendto(socketfd, packet, ICMP_HDRLEN + datalen, 0, (struct sockaddr *)&dest_in, sizeof(dest_in));
+			stats.syscalls++;
 			if (bytes_sent == -1)
 			{
-				fprintf(stderr, "sendto() failed with error: %d", errno);
-				return -1;
+				// Count it and try again next time, the watchdog still ends the program if it never recovers.
+				stats.send_errors++;
+				fprintf(stderr, "sendto() failed with error: %d\n", errno);
+				counter++;
+				next = mono_ns() + rto_interval(&rto, interval) * 1000LL;
+				sleep_until(next);
+				continue;
 			}
-			// Wait and receive the ICMP ECHO REPLAY packet.
-			bytes_received = receiveICMP(socketfd, icmp_response, sizeof(icmp_response), &dest_in, &addr_len);
+
+			// Wait and receive the ICMP ECHO REPLAY packet, for at most the target's RTO.
+			int64_t deadline = mono_ns() + rto.timeout * 1000LL;
+			bytes_received = receiveICMP(socketfd, icmp_response, sizeof(icmp_response), &dest_in, &addr_len, seq, deadline);
 
 			// Calculate ending time.
 			gettimeofday(&end, NULL);
 
-			// Send OK signal to watchdog.
-			send_packet(watchdog_sock, &sign, sizeof(char));
-
-			// Calculate the time it took to send and receive the packet
-			time = (end.tv_sec - start.tv_sec) * 1000.0f + (end.tv_usec - start.tv_usec) / 1000.0f;
-
-			// Extract the ICMP ECHO Replay headers via the IP header
-			iphdr = (struct iphdr *)icmp_response;
-			icmphdr = (struct icmphdr *)(icmp_response + iphdr->ihl * 4);
+			struct ring_record record = {
+				.ts_ns = start.tv_sec * 1000000000LL + start.tv_usec * 1000LL,
+				.target = dest_in.sin_addr.s_addr,
+				.seq = seq,
+			};
 
-			inet_ntop(AF_INET, &(iphdr->saddr), space, INET_ADDRSTRLEN);
+			if (bytes_received == 0)
+			{
+				// No reply within the RTO: the probe is lost, back off. The watchdog is fed while the backoff
+				// grows, so the probing can actually slow down to the longest interval; once there, it is
+				// not fed anymore and ends the program 10 seconds later.
+				if (rto.backoff < RTO_BACKOFF_MAX)
+					feed_watchdog();
+				rto_lost(&rto);
+				printf("	Request timeout for icmp_seq=%d\n", counter++);
+				trace_mark(seq, TRACE_REPORTED, 0);
+				record.status = RING_LOST;
+			}
+			else
+			{
+				// Send OK signal to watchdog.
+				feed_watchdog();
+
+				// Calculate the time it took to send and receive the packet
+				time = (end.tv_sec - start.tv_sec) * 1000.0f + (end.tv_usec - start.tv_usec) / 1000.0f;
+				record.rtt_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+				rto_sample(&rto, record.rtt_us);
+
+				// Extract the ICMP ECHO Replay headers via the IP header
+				iphdr = (struct iphdr *)icmp_response;
+				icmphdr = (struct icmphdr *)(icmp_response + iphdr->ihl * 4);
+
+				inet_ntop(AF_INET, &(iphdr->saddr), space, INET_ADDRSTRLEN);
+
+				// Print the packet data (total length, source IP address, ICMP ECHO REPLAY sequance number, IP Time-To-Live and the calculated time).
+				printf("	%ld bytes from %s: icmp_seq=%d ttl=%d time=%0.3f ms\n",  bytes_received, space, counter++,iphdr->ttl,time);
+				trace_mark(seq, TRACE_REPORTED, 0);
+				record.bytes = bytes_received;
+				record.ttl = iphdr->ttl;
+				record.status = RING_REPLY;
+			}
 
-			// Print the packet data (total length, source IP address, ICMP ECHO REPLAY sequance number, IP Time-To-Live and the calculated time).
-			printf("	%ld bytes from %s: icmp_seq=%d ttl=%d time=%0.3f ms\n",  bytes_received, space, counter++,iphdr->ttl,time);
+			// Publish the result for the local consumers too.
+			if (ring != NULL)
+				ring_publish(ring, &record);
+			if (archive != NULL &&
+				archive_append(archive, record.ts_ns / 1000, record.status == RING_LOST ? ARCHIVE_LOST : (int32_t)record.rtt_us) == -1)
+				perror("archive_append");
 
 			// Make the ping program sleep some time before sending another ICMP ECHO packet.
-			usleep(PING_TIMEOUT_IN_MS); 
+			// Back to the normal interval on the first reply, longer and longer while the target does not answer.
+			next = mono_ns() + rto_interval(&rto, interval) * 1000LL;
+			sleep_until(next);
 		}
 	}
 
@@ -239,10 +396,13 @@ int non_blocking(int sock)
 ssize_t send_packet(int sock, void *buffer, int len)
 {
 	ssize_t s = send(sock, buffer, len, MSG_DONTWAIT);
+	stats.syscalls++;
 
 	if (s == -1)
 	{
+		stats.send_errors++;
 		perror("send");
+		stats_dump();
 		exit(errno);
 	}
 
@@ -260,68 +420,246 @@ ssize_t send_packet(int sock, void *buffer, int len)
 ssize_t receive_packet(int socketfd, void *buffer, int len)
 {
 	ssize_t r = recv(socketfd, buffer, len, MSG_DONTWAIT);
+	stats.syscalls++;
 
 	if (r == -1)
 	{
 		if (errno != EWOULDBLOCK)
 		{
 			perror("recv");
+			stats_dump();
 			exit(errno);
 		}
+		stats.eagains++;
 	}
 
 	return r;
 }
 /**
- * @brief receiveICMP() receives an ICMP ECHO REPLAY packet.
+ * @brief receiveICMP() receives the ICMP ECHO REPLAY packet of the current probe.
+ * Anything else that reaches the raw socket (our own ECHO requests on loopback, other hosts, stale
+ * replies) is counted as a parse reject and skipped.
  * 
  * @param sock  - the socket to receive the packet from.
  * @param response  - the buffer to receive the packet to.
  * @param response_len  - the length of the buffer.
- * @param dest_in  - the destination address.
+ * @param dest_in  - the destination address, replies must come from it.
  * @param length  - the length of the destination address.
- * @return ssize_t  -1 if failed, otherwise the number of bytes received.
+ * @param seq  - the sequence number of the current probe.
+ * @param deadline  - the time the probe is declared lost, in nanoseconds of the monotonic clock.
+ * @return ssize_t  0 if the probe is lost, otherwise the number of bytes received.
  */
-ssize_t receiveICMP(int sock, void *response, int response_len, struct sockaddr_in *dest_in, socklen_t *length)
+ssize_t receiveICMP(int sock, void *response, int response_len, struct sockaddr_in *dest_in, socklen_t *length,
+					uint16_t seq, int64_t deadline)
 {
 	ssize_t bytes_received = 0;
+	struct sockaddr_in from;
+	char control[256];
+	struct iovec iov = {.iov_base = response, .iov_len = response_len};
+	struct msghdr msg;
 
 	bzero(response, IP_MAXPACKET); // Clear the buffer.
 
 	while (bytes_received <= 0)
 	{
 		// Trying to receive an ICMP ECHO REPLAY packet.
-		bytes_received = recvfrom(sock, response, response_len, 0, (struct sockaddr *)dest_in, length);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &from;
+		msg.msg_namelen = *length;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		bytes_received = recvmsg(sock, &msg, 0);
+		stats.syscalls++;
 
 		if (bytes_received == -1)
 		{
 			// Filter Non-Blocking I/O.
 			if (errno != EAGAIN)
 			{
-				perror("recvfrom");
+				perror("recvmsg");
+				stats_dump();
 				exit(errno);
 			}
+			stats.eagains++;
 
-			// Check with watchdog if timeout passed.
-			char sign = '\0'; // OK signal
-
-			receive_packet(watchdog_sock, &sign, sizeof(char));
+			// Nothing yet: wait for the reply, the watchdog or the end of the RTO, whichever comes first.
+			if (mono_ns() >= deadline)
+				return 0;
+			wait_for(sock, deadline);
+			bytes_received = 0;
+		}
 
-			if (sign == '-') // means timeout passed
+		else if (bytes_received > 0) // We received an ICMP packet, check it is our ECHO REPLAY.
+		{
+			int64_t kernel_rx = 0;
+			for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
 			{
-				printf("Server %s cannot be reached.\n", dest);
-				close(watchdog_sock);
-				exit(0);
+				if (cm->cmsg_level != SOL_SOCKET)
+					continue;
+				if (cm->cmsg_type == SO_RXQ_OVFL)
+					stats.drops = *(uint32_t *)CMSG_DATA(cm); // Running total kept by the kernel.
+				else if (cm->cmsg_type == SO_TIMESTAMPNS)
+				{
+					struct timespec *ts = (struct timespec *)CMSG_DATA(cm);
+					kernel_rx = (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+				}
 			}
-		}
 
-		else if (bytes_received > 0) // We received an ICMP ECHO REPLAY packet.
+			struct iphdr *iphdr = (struct iphdr *)response;
+			struct icmphdr *icmphdr = (struct icmphdr *)((char *)response + iphdr->ihl * 4);
+			if (bytes_received < iphdr->ihl * 4 + ICMP_HDRLEN || from.sin_addr.s_addr != dest_in->sin_addr.s_addr ||
+				icmphdr->type != ICMP_ECHOREPLY || icmphdr->un.echo.id != (uint16_t)getpid() ||
+				icmphdr->un.echo.sequence != htons(seq))
+			{
+				stats.parse_rejects++;
+				bytes_received = 0;
+				continue;
+			}
+			trace_mark(seq, TRACE_KERNEL_RX, kernel_rx);
+			trace_mark(seq, TRACE_PARSED, 0);
 			break;
+		}
 	}
 
 	return bytes_received;
 }
 
+/**
+ * @brief check_watchdog() reads the watchdog's signal and ends the program if the timeout passed.
+ */
+void check_watchdog(void)
+{
+	char sign = '\0'; // OK signal
+
+	if (receive_packet(watchdog_sock, &sign, sizeof(char)) == 0)
+	{
+		fprintf(stderr, "Watchdog exited\n");
+		stats_dump();
+		exit(1);
+	}
+
+	if (sign == '-') // means timeout passed
+	{
+		printf("Server %s cannot be reached.\n", dest);
+		close(watchdog_sock);
+		exit(0);
+	}
+}
+
+/**
+ * @brief feed_watchdog() sends the OK signal to the watchdog, at most once per WATCHDOG_FEED_IN_NS.
+ * The watchdog reads a single sign per second: faster probes would fill its socket and delay its timeout.
+ */
+void feed_watchdog(void)
+{
+	char sign = '+'; // OK signal
+	int64_t now = mono_ns();
+
+	if (now - watchdog_fed < WATCHDOG_FEED_IN_NS)
+		return;
+	send_packet(watchdog_sock, &sign, sizeof(char));
+	watchdog_fed = now;
+}
+
+/**
+ * @brief wait_for() blocks until the socket is readable, the watchdog talks or the deadline passes.
+ * The watchdog's signal, the dump signal and the stop signals are handled here.
+ *
+ * @param sock - the socket to wait for, -1 to only wait for the watchdog.
+ * @param deadline - the deadline in nanoseconds of the monotonic clock.
+ */
+void wait_for(int sock, int64_t deadline)
+{
+	struct pollfd fds[3] = {
+		{.fd = sock, .events = POLLIN}, {.fd = watchdog_sock, .events = POLLIN}, {.fd = timer_fd, .events = POLLIN}};
+	struct itimerspec its = {.it_value = {.tv_sec = deadline / 1000000000LL, .tv_nsec = deadline % 1000000000LL}};
+
+	// Arming the timer also clears its expirations from the previous wait.
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	stats.syscalls += 2;
+	int result = ppoll(fds, 3, NULL, &wait_mask);
+	stats_poll();
+	if (result == -1)
+	{
+		if (errno != EINTR)
+		{
+			perror("ppoll");
+			stats_dump();
+			exit(errno);
+		}
+		if (stop)
+		{
+			// Tell the watchdog to shut down too, then exit (close_archive() runs at exit).
+			send(watchdog_sock, &end, sizeof(char), MSG_DONTWAIT);
+			exit(0);
+		}
+		return;
+	}
+
+	if (fds[1].revents != 0)
+		check_watchdog();
+}
+
+/**
+ * @brief sleep_until() sleeps until the given monotonic time, and accounts how late it woke up.
+ * The watchdog and the signals are still listened to while sleeping.
+ *
+ * @param deadline - the wakeup time in nanoseconds of the monotonic clock.
+ */
+void sleep_until(int64_t deadline)
+{
+	if (mono_ns() >= deadline)
+		take_signals(); // no wait this time (-i 0, or a late probe)
+	while (mono_ns() < deadline)
+		wait_for(-1, deadline);
+	timer_record(deadline);
+}
+
+/**
+ * @brief take_signals() delivers the pending stop and dump signals without waiting.
+ * ppoll() only delivers them when it actually blocks, so a program that never waits would never get them.
+ */
+void take_signals(void)
+{
+	sigset_t pending;
+
+	stats.syscalls++;
+	if (sigpending(&pending) == -1 ||
+		(!sigismember(&pending, SIGINT) && !sigismember(&pending, SIGTERM) && !sigismember(&pending, SIGUSR1)))
+		return;
+
+	// Returns at once, once the handlers of the pending signals ran.
+	sigsuspend(&wait_mask);
+	stats.syscalls++;
+	stats_poll();
+	if (stop)
+	{
+		send(watchdog_sock, &end, sizeof(char), MSG_DONTWAIT);
+		exit(0);
+	}
+}
+
+/**
+ * @brief on_stop() is the SIGINT / SIGTERM handler, the program stops in wait_for() or take_signals().
+ */
+void on_stop(int signum)
+{
+	(void)signum;
+	stop = 1;
+}
+
+/**
+ * @brief close_archive() writes the buffered results and the index of the archive, at exit.
+ */
+void close_archive(void)
+{
+	if (archive_close(archive) == -1)
+		perror("archive_close");
+	archive = NULL;
+}
+
 /**
  * @brief calculate_checksum() calculates the checksum of the ICMP ECHO packet.
  *
@@ -0,0 +1,91 @@
+// Self-metrics and probe lifecycle trace of the ping program.
+
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+
+#include "stats.h"
+
+__thread struct ping_stats stats;
+bool trace_enabled = false;
+struct trace_record trace[TRACE_SIZE];
+
+static volatile sig_atomic_t dump_requested = 0;
+
+static const char *stage_names[TRACE_STAGES] = {"scheduled", "sent", "kernel_rx", "parsed", "reported"};
+
+/**
+ * @brief Signal handler, only flags the request: the dump itself is done by stats_poll().
+ */
+static void on_dump_signal(int signum)
+{
+	(void)signum;
+	dump_requested = 1;
+}
+
+/**
+ * @brief stats_install() makes the given signal dump the stats and the trace.
+ * The signal interrupts the blocking calls of the main loop (no SA_RESTART), which then call stats_poll().
+ *
+ * @param signum - the signal, e.g. SIGUSR1.
+ */
+void stats_install(int signum)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_dump_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(signum, &sa, NULL);
+}
+
+/**
+ * @brief stats_poll() dumps the stats if the dump signal was received.
+ */
+void stats_poll(void)
+{
+	if (!dump_requested)
+		return;
+	dump_requested = 0;
+	stats_dump();
+}
+
+/**
+ * @brief stats_dump() prints the counters, and the trace if enabled, to stderr.
+ * Trace timestamps are printed as microseconds relative to the scheduled time of the probe.
+ */
+void stats_dump(void)
+{
+	fprintf(stderr, "stats: syscalls=%lu eagain=%lu drops=%lu parse_rejects=%lu send_errors=%lu "
+					"timer_late=%lu timer_late_avg_us=%.1f timer_late_max_us=%.1f\n",
+			stats.syscalls, stats.eagains, stats.drops, stats.parse_rejects, stats.send_errors, stats.timer_late,
+			stats.timer_late ? stats.timer_late_ns / 1e3 / stats.timer_late : 0.0, stats.timer_late_max_ns / 1e3);
+
+	if (!trace_enabled)
+		return;
+
+	// Oldest first: start right after the slot of the newest probe.
+	uint32_t newest = 0;
+	for (int i = 0; i < TRACE_SIZE; i++)
+	{
+		if (trace[i].ts[TRACE_SCHEDULED] != 0 && trace[i].ts[TRACE_SCHEDULED] > trace[newest].ts[TRACE_SCHEDULED])
+			newest = i;
+	}
+	for (int n = 1; n <= TRACE_SIZE; n++)
+	{
+		struct trace_record *r = &trace[(newest + n) & (TRACE_SIZE - 1)];
+		if (r->ts[TRACE_SCHEDULED] == 0)
+			continue;
+
+		fprintf(stderr, "trace: seq=%u scheduled=%ld.%06ld", r->seq, r->ts[TRACE_SCHEDULED] / 1000000000L,
+				(r->ts[TRACE_SCHEDULED] % 1000000000L) / 1000);
+		for (int stage = TRACE_SENT; stage < TRACE_STAGES; stage++)
+		{
+			if (r->ts[stage] != 0)
+				fprintf(stderr, " %s=+%.1fus", stage_names[stage], (r->ts[stage] - r->ts[TRACE_SCHEDULED]) / 1e3);
+			else
+				fprintf(stderr, " %s=-", stage_names[stage]);
+		}
+		fprintf(stderr, "\n");
+	}
+}
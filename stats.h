@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define TRACE_SIZE 1024 // number of probes kept by the trace, must be a power of 2
+
+// Self-metrics of the prober, one set per thread so the hot path never shares a cache line.
+struct ping_stats
+{
+	uint64_t syscalls;		// socket and sleep system calls made
+	uint64_t eagains;		// non-blocking calls that found nothing to do
+	uint64_t drops;			// packets dropped by the kernel on our receive queue (SO_RXQ_OVFL)
+	uint64_t parse_rejects; // received packets that were not a reply to our current probe
+	uint64_t send_errors;	// failed sendto() / send()
+	uint64_t timer_late;	// wakeups later than TIMER_LATE_IN_NS after their deadline
+	uint64_t timer_late_ns; // total lateness of the wakeups
+	uint64_t timer_late_max_ns;
+};
+
+// Lifecycle of a probe, every stage gets a CLOCK_REALTIME timestamp (same clock as the kernel's).
+enum trace_stage
+{
+	TRACE_SCHEDULED,
+	TRACE_SENT,
+	TRACE_KERNEL_RX,
+	TRACE_PARSED,
+	TRACE_REPORTED,
+	TRACE_STAGES
+};
+
+struct trace_record
+{
+	uint32_t seq;
+	int64_t ts[TRACE_STAGES];
+};
+
+#define TIMER_LATE_IN_NS (50 * 1000)
+
+extern __thread struct ping_stats stats;
+extern bool trace_enabled;
+extern struct trace_record trace[TRACE_SIZE];
+
+void stats_install(int signum);
+void stats_poll(void);
+void stats_dump(void);
+
+/**
+ * @brief now_ns() returns the wall clock in nanoseconds.
+ */
+static inline int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief mono_ns() returns the monotonic clock in nanoseconds, for deadlines: it never steps with the wall clock.
+ */
+static inline int64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief trace_mark() stamps a stage of a probe, costs a single branch when the trace is off.
+ *
+ * @param seq - the probe sequence number.
+ * @param stage - the lifecycle stage.
+ * @param ns - the timestamp, 0 to take the current time.
+ */
+static inline void trace_mark(uint32_t seq, enum trace_stage stage, int64_t ns)
+{
+	if (!trace_enabled)
+		return;
+
+	struct trace_record *r = &trace[seq & (TRACE_SIZE - 1)];
+	if (stage == TRACE_SCHEDULED || r->seq != seq)
+	{
+		// The slot is reused by a newer probe.
+		for (int i = 0; i < TRACE_STAGES; i++)
+			r->ts[i] = 0;
+		r->seq = seq;
+	}
+	r->ts[stage] = ns != 0 ? ns : now_ns();
+}
+
+/**
+ * @brief timer_record() accounts the lateness of a wakeup.
+ *
+ * @param deadline - the requested wakeup time (mono_ns() clock).
+ */
+static inline void timer_record(int64_t deadline)
+{
+	int64_t late = mono_ns() - deadline;
+
+	if (late < TIMER_LATE_IN_NS)
+		return;
+	stats.timer_late++;
+	stats.timer_late_ns += late;
+	if ((uint64_t)late > stats.timer_late_max_ns)
+		stats.timer_late_max_ns = late;
+}
@@ -118,7 +118,7 @@ int main()
     }
 
     // Time functionality
-    while (time < 10) // 10 seconds.
+    while (time < WATCHDOG_LIMIT_IN_S) // 10 seconds.
     {
         bytes_received = receive_packet(client_socket, &sign, sizeof(char));
 